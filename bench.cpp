@@ -0,0 +1,463 @@
+/*
+Test Lib SWS - Benchmarks for libsws
+Copyright (C) 2022 Pierre-Yves Rollo <dev@pyrollo.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Builds synthetic schemas and prints one JSON object per schema on stdout:
+//
+//   bench-libsws [scale]
+//
+// scale multiplies the size of every generated schema (default 1).
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include "swsengine.h"
+
+using namespace std;
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Heap bytes and blocks currently allocated through operator new, including
+// the ones made by libsws. Each block carries its size in a header. new and
+// delete are kept out of line: once inlined into callers, GCC sees the header
+// arithmetic and warns about out of bounds and mismatched free().
+static size_t liveBytes = 0;
+static size_t liveBlocks = 0;
+static const size_t headerSize = 16;
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    char *block = static_cast<char *>(malloc(size + headerSize));
+    if (!block)
+        throw std::bad_alloc();
+    *reinterpret_cast<size_t *>(block) = size;
+    liveBytes += size;
+    liveBlocks++;
+    return block + headerSize;
+}
+
+__attribute__((noinline)) void operator delete(void *ptr) noexcept
+{
+    if (!ptr)
+        return;
+    char *block = static_cast<char *>(ptr) - headerSize;
+    liveBytes -= *reinterpret_cast<size_t *>(block);
+    liveBlocks--;
+    free(block);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+// Every other form goes through the two above, so that no block is ever
+// released without its header
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    try {
+        return operator new(size);
+    } catch (const std::bad_alloc &) {
+        return nullptr;
+    }
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    operator delete(ptr);
+}
+
+// A generated schema: which plug to drive, which plug to read, the input
+// plug to query listConnectable on and the plugs a consumer would poll
+// after each step.
+struct Schema
+{
+    std::string name;
+    int modules = 0;
+    int connections = 0;
+    std::string input;
+    std::string output;
+    std::string connectable;
+    std::vector<std::string> polled;
+};
+
+// in -> addN, all addN summed by a chain of adds: many independent modules
+Schema buildWide(swsEngine &sws, int width)
+{
+    Schema schema;
+    schema.name = "wide";
+    sws.newModule("in", "input");
+    sws.newModule("zero", "value");
+    schema.modules = 2;
+    for (int i = 0; i < width; i++) {
+        std::string n = std::to_string(i);
+        sws.newModule("add" + n, "add");
+        sws.newModule("sum" + n, "add");
+        sws.connect("in#value", "add" + n + "#op1");
+        sws.connect("in#value", "add" + n + "#op2");
+        sws.connect("add" + n + "#result", "sum" + n + "#op2");
+        sws.connect(i ? "sum" + std::to_string(i - 1) + "#result" : "zero#value",
+            "sum" + n + "#op1");
+        schema.modules += 2;
+        schema.connections += 4;
+        schema.polled.push_back("sum" + n + "#result");
+    }
+    sws.newModule("free", "add");
+    schema.modules++;
+    schema.input = "in#value";
+    schema.output = "sum" + std::to_string(width - 1) + "#result";
+    schema.connectable = "free#op1";
+    return schema;
+}
+
+// add0 -> add1 -> ... : one long dependency chain
+Schema buildChain(swsEngine &sws, int length)
+{
+    Schema schema;
+    schema.name = "chain";
+    sws.newModule("in", "input");
+    schema.modules = 1;
+    for (int i = 0; i < length; i++) {
+        std::string n = std::to_string(i);
+        sws.newModule("add" + n, "add");
+        sws.connect(i ? "add" + std::to_string(i - 1) + "#result" : "in#value", "add" + n + "#op1");
+        sws.connect("in#value", "add" + n + "#op2");
+        schema.modules++;
+        schema.connections += 2;
+        schema.polled.push_back("add" + n + "#result");
+    }
+    schema.input = "in#value";
+    schema.output = "add" + std::to_string(length - 1) + "#result";
+    schema.connectable = "add0#op1";
+    sws.disconnect("in#value", "add0#op1");
+    schema.connections--;
+    return schema;
+}
+
+// c/c/c/... pass-through containers around one add, each level also holding
+// a few unconnected modules
+Schema buildDeep(swsEngine &sws, int depth)
+{
+    Schema schema;
+    schema.name = "deep";
+    sws.newModule("in", "input");
+    sws.newModule("out", "output");
+    schema.modules = 2;
+    std::string path;
+    for (int level = 0; level < depth; level++) {
+        std::string parent = path;
+        path += (level ? "/c" : "c");
+        sws.newModule(path, "container");
+        sws.newModule(path + "/in", "input");
+        sws.newModule(path + "/out", "output");
+        for (int i = 0; i < 4; i++)
+            sws.newModule(path + "/pad" + std::to_string(i), "add");
+        schema.modules += 7;
+        if (level) {
+            sws.connect(parent + "/in#value", path + "#in");
+            sws.connect(path + "#out", parent + "/out#value");
+            schema.connections += 2;
+        }
+    }
+    sws.newModule(path + "/add", "add");
+    sws.connect(path + "/in#value", path + "/add#op1");
+    sws.connect(path + "/in#value", path + "/add#op2");
+    sws.connect(path + "/add#result", path + "/out#value");
+    sws.connect("in#value", "c#in");
+    sws.connect("c#out", "out#value");
+    schema.modules++;
+    schema.connections += 5;
+    schema.input = "in#value";
+    schema.output = "out#value";
+    schema.connectable = path + "/pad0#op1";
+    schema.polled.push_back(schema.output);
+    return schema;
+}
+
+// One template container instantiated many times, all fed by one input
+Schema buildInstances(swsEngine &sws, int count)
+{
+    Schema schema;
+    schema.name = "instances";
+    sws.newModule("in", "input");
+    sws.newModule("entity",        "container");
+    sws.newModule("entity/op",     "input");
+    sws.newModule("entity/result", "output");
+    sws.newModule("entity/gain",   "value");
+    sws.newModule("entity/mult",   "multiply");
+    sws.set("entity/gain#value", 2);
+    sws.connect("entity/op#value",    "entity/mult#op1");
+    sws.connect("entity/gain#value",  "entity/mult#op2");
+    sws.connect("entity/mult#result", "entity/result#value");
+    schema.modules = 6;
+    schema.connections = 3;
+    for (int i = 0; i < count; i++) {
+        std::string n = "entity" + std::to_string(i);
+        sws.instantiateModule(n, "entity");
+        sws.connect("in#value", n + "#op");
+        schema.modules += 5;
+        schema.connections += 4;
+        schema.polled.push_back(n + "#result");
+    }
+    schema.input = "in#value";
+    schema.output = "entity" + std::to_string(count - 1) + "#result";
+    schema.connectable = "entity#op";
+    return schema;
+}
+
+// valN -> addN (valN + valN) branches, of which only the first one is driven:
+// most polled plugs never change
+Schema buildSparse(swsEngine &sws, int width)
+{
+    Schema schema;
+    schema.name = "sparse";
+    for (int i = 0; i < width; i++) {
+        std::string n = std::to_string(i);
+        sws.newModule("val" + n, "value");
+        sws.newModule("add" + n, "add");
+        sws.set("val" + n + "#value", 1);
+        sws.connect("val" + n + "#value", "add" + n + "#op1");
+        sws.connect("val" + n + "#value", "add" + n + "#op2");
+        schema.modules += 2;
+        schema.connections += 2;
+        schema.polled.push_back("add" + n + "#result");
+    }
+    sws.newModule("free", "add");
+    schema.modules++;
+    schema.input = "val0#value";
+    schema.output = "add0#result";
+    schema.connectable = "free#op1";
+    return schema;
+}
+
+void bench(Schema (*build)(swsEngine &, int), int size)
+{
+    const int steps = 100;
+    const int accesses = 10000;
+    const int listings = 10;
+
+    size_t memoryBefore = liveBytes;
+    swsEngine *sws = new swsEngine;
+
+    Clock::time_point start = Clock::now();
+    Schema built = build(*sws, size);
+    double buildMs = elapsedMs(start);
+
+    // Engine memory only: what the Schema itself holds (plug names) is what
+    // gets released when the built one is freed after being copied
+    size_t memoryAfter = liveBytes;
+    Schema schema = built;
+    size_t schemaCopied = liveBytes;
+    {
+        Schema released = std::move(built);
+    }
+    long memory = (long)memoryAfter - (long)memoryBefore
+        - ((long)schemaCopied - (long)liveBytes);
+
+    start = Clock::now();
+    for (int i = 0; i < steps; i++) {
+        sws->set(schema.input, i % 7);
+        sws->step();
+    }
+    double stepMs = elapsedMs(start) / steps;
+
+    // Polling every watched plug after each step, and how many of them
+    // actually changed
+    std::vector<float> previous(schema.polled.size());
+    double pollMs = 0;
+    long changed = 0;
+    for (int i = 0; i < steps; i++) {
+        sws->set(schema.input, i % 7);
+        sws->step();
+        start = Clock::now();
+        for (size_t p = 0; p < schema.polled.size(); p++) {
+            float value = sws->get(schema.polled[p]);
+            if (i && value != previous[p])
+                changed++;
+            previous[p] = value;
+        }
+        pollMs += elapsedMs(start);
+    }
+    pollMs /= steps;
+
+    start = Clock::now();
+    for (int i = 0; i < accesses; i++)
+        sws->set(schema.input, i % 7);
+    double setNs = elapsedMs(start) * 1e6 / accesses;
+
+    float sink = 0;
+    start = Clock::now();
+    for (int i = 0; i < accesses; i++)
+        sink += sws->get(schema.output);
+    double getNs = elapsedMs(start) * 1e6 / accesses;
+
+    size_t connectable = 0;
+    start = Clock::now();
+    for (int i = 0; i < listings; i++)
+        connectable += sws->listConnectable(schema.connectable).size();
+    double listMs = elapsedMs(start) / listings;
+
+    start = Clock::now();
+    delete sws;
+    double destroyMs = elapsedMs(start);
+
+    printf("{\"schema\": \"%s\", \"size\": %d, \"modules\": %d, \"connections\": %d, "
+        "\"build_ms\": %.3f, \"step_ms\": %.4f, \"steps_per_s\": %.1f, "
+        "\"set_ns\": %.1f, \"get_ns\": %.1f, \"list_connectable_ms\": %.4f, "
+        "\"polled\": %zu, \"changed_per_step\": %.1f, \"poll_ms\": %.4f, "
+        "\"destroy_ms\": %.3f, \"bytes_per_module\": %.1f, \"checksum\": %g}\n",
+        schema.name.c_str(), size, schema.modules, schema.connections,
+        buildMs, stepMs, stepMs > 0 ? 1000 / stepMs : 0,
+        setNs, getNs, listMs,
+        schema.polled.size(), (double)changed / (steps - 1), pollMs,
+        destroyMs, (double)memory / schema.modules, sink + connectable);
+    fflush(stdout);
+}
+
+// Heap kept by one kind of edit, per edit. Negative when edits free more
+// than they allocate.
+struct Footprint
+{
+    long bytes = 0;
+    long blocks = 0;
+
+    void start()
+    {
+        bytes = liveBytes;
+        blocks = liveBlocks;
+    }
+
+    void stop(int count)
+    {
+        bytes = ((long)liveBytes - bytes) / count;
+        blocks = ((long)liveBlocks - blocks) / count;
+    }
+};
+
+// Splits engine memory into modules, connections, instantiated modules and
+// names, as seen from the heap
+void benchMemory(int size)
+{
+    const int instances = size / 10;
+    Footprint module, connection, instance;
+    swsEngine sws;
+
+    module.start();
+    for (int i = 0; i < size; i++)
+        sws.newModule("add" + std::to_string(i), "add");
+    module.stop(size);
+
+    connection.start();
+    for (int i = 1; i < size; i++)
+        sws.connect("add" + std::to_string(i - 1) + "#result", "add" + std::to_string(i) + "#op1");
+    connection.stop(size - 1);
+
+    // Same 5 module container as buildInstances()
+    sws.newModule("entity",        "container");
+    sws.newModule("entity/op",     "input");
+    sws.newModule("entity/result", "output");
+    sws.newModule("entity/gain",   "value");
+    sws.newModule("entity/mult",   "multiply");
+    sws.connect("entity/op#value",    "entity/mult#op1");
+    sws.connect("entity/gain#value",  "entity/mult#op2");
+    sws.connect("entity/mult#result", "entity/result#value");
+
+    instance.start();
+    for (int i = 0; i < instances; i++)
+        sws.instantiateModule("entity" + std::to_string(i), "entity");
+    instance.stop(instances * 5);
+
+    // Extra cost of a 64 characters name over an 8 characters one, per
+    // character, measured on value modules in two fresh engines
+    const std::string padding(64 - 8, 'x');
+    Footprint shortName, longName;
+    {
+        swsEngine names;
+        shortName.start();
+        for (int i = 0; i < size; i++)
+            names.newModule(std::to_string(10000000 + i), "value");
+        shortName.stop(size);
+    }
+    {
+        swsEngine names;
+        longName.start();
+        for (int i = 0; i < size; i++)
+            names.newModule(padding + std::to_string(10000000 + i), "value");
+        longName.stop(size);
+    }
+
+    printf("{\"schema\": \"memory\", \"size\": %d, "
+        "\"bytes_per_module\": %ld, \"blocks_per_module\": %ld, "
+        "\"bytes_per_connection\": %ld, \"blocks_per_connection\": %ld, "
+        "\"bytes_per_instance_module\": %ld, \"blocks_per_instance_module\": %ld, "
+        "\"bytes_per_name_char\": %.2f}\n",
+        size, module.bytes, module.blocks,
+        connection.bytes, connection.blocks,
+        instance.bytes, instance.blocks,
+        longName.bytes > shortName.bytes
+            ? (double)(longName.bytes - shortName.bytes) / padding.size() : 0.0);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int scale = argc > 1 ? atoi(argv[1]) : 1;
+    if (scale < 1)
+        scale = 1;
+
+    bench(buildWide, 1000 * scale);
+    bench(buildChain, 1000 * scale);
+    bench(buildDeep, 50 * scale);
+    bench(buildInstances, 500 * scale);
+    bench(buildSparse, 1000 * scale);
+    benchMemory(1000 * scale);
+
+    return 0;
+}
@@ -0,0 +1,671 @@
+/*
+Test Lib SWS - Unit tests for libsws
+Copyright (C) 2022 Pierre-Yves Rollo <dev@pyrollo.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <typeinfo>
+#include <vector>
+#include "swsengine.h"
+#include "test.h"
+#include "fuzz.h"
+
+// One call to swsEngine. Connect and Disconnect take the output plug first.
+struct Op
+{
+    enum Kind { NewModule, DeleteModule, Instantiate, Connect, Disconnect, Set, Step };
+
+    Kind kind;
+    std::string a;
+    std::string b;
+    int value;
+};
+
+enum Outcome { Pass, Invalid, Fail };
+
+// All values are integers, which a float engine holds exactly up to 2^24. A
+// plug is not compared if any value its result depends on goes beyond.
+static const double maxCompared = 16777216;
+
+static std::string parentOf(const std::string &path)
+{
+    size_t pos = path.rfind('/');
+    return pos == std::string::npos ? "" : path.substr(0, pos);
+}
+
+static std::string nameOf(const std::string &path)
+{
+    return path.substr(path.rfind('/') + 1);
+}
+
+static std::string join(const std::string &container, const std::string &name)
+{
+    return container.empty() ? name : container + "/" + name;
+}
+
+static std::string moduleOf(const std::string &plug)
+{
+    return plug.substr(0, plug.find('#'));
+}
+
+// Whether path is below ancestor ("" is the root schema)
+static bool isBelow(const std::string &path, const std::string &ancestor)
+{
+    return ancestor.empty() || path.compare(0, ancestor.size() + 1, ancestor + "/") == 0;
+}
+
+// Whether path is ancestor itself or below it
+static bool isInside(const std::string &path, const std::string &ancestor)
+{
+    return path == ancestor || isBelow(path, ancestor);
+}
+
+// Reference model of a schema: evaluates plugs directly from the connection
+// graph, with no caching between steps.
+class Model
+{
+public:
+    std::map<std::string, std::string> types;   // module path -> type
+    std::map<std::string, std::string> sources; // input plug -> output plug
+    std::map<std::string, double> values;       // plug -> value set
+
+    bool isContainer(const std::string &path) const
+    {
+        return path.empty() || (types.count(path) && types.at(path) == "container");
+    }
+
+    std::vector<std::string> children(const std::string &container) const
+    {
+        std::vector<std::string> result;
+        for (auto &it: types)
+            if (parentOf(it.first) == container && !it.first.empty())
+                result.push_back(it.first);
+        return result;
+    }
+
+    std::vector<std::string> inputPlugs(const std::string &module) const
+    {
+        const std::string &type = types.at(module);
+        if (type == "add" || type == "multiply")
+            return { module + "#op1", module + "#op2" };
+        if (type == "output")
+            return { module + "#value" };
+        std::vector<std::string> result;
+        if (type == "container")
+            for (auto &child: children(module))
+                if (types.at(child) == "input")
+                    result.push_back(module + "#" + nameOf(child));
+        return result;
+    }
+
+    std::vector<std::string> outputPlugs(const std::string &module) const
+    {
+        const std::string &type = types.at(module);
+        if (type == "add" || type == "multiply")
+            return { module + "#result" };
+        if (type == "value" || type == "input")
+            return { module + "#value" };
+        std::vector<std::string> result;
+        if (type == "container")
+            for (auto &child: children(module))
+                if (types.at(child) == "output")
+                    result.push_back(module + "#" + nameOf(child));
+        return result;
+    }
+
+    bool isInputPlug(const std::string &plug) const
+    {
+        std::string module = moduleOf(plug);
+        if (!types.count(module))
+            return false;
+        for (auto &it: inputPlugs(module))
+            if (it == plug)
+                return true;
+        return false;
+    }
+
+    bool isOutputPlug(const std::string &plug) const
+    {
+        std::string module = moduleOf(plug);
+        if (!types.count(module))
+            return false;
+        for (auto &it: outputPlugs(module))
+            if (it == plug)
+                return true;
+        return false;
+    }
+
+    bool hasConsumers(const std::string &module) const
+    {
+        for (auto &it: sources)
+            if (moduleOf(it.second) == module)
+                return true;
+        return false;
+    }
+
+    // Whether "to" is "from" or downstream of it, in the schema holding both.
+    // A container counts as depending on all its inputs.
+    bool reaches(const std::string &from, const std::string &to) const
+    {
+        std::set<std::string> seen;
+        std::vector<std::string> pending = { from };
+        while (!pending.empty()) {
+            std::string module = pending.back();
+            pending.pop_back();
+            if (module == to)
+                return true;
+            if (!seen.insert(module).second)
+                continue;
+            for (auto &it: sources)
+                if (moduleOf(it.second) == module)
+                    pending.push_back(moduleOf(it.first));
+        }
+        return false;
+    }
+
+    bool canConnect(const std::string &output, const std::string &input) const
+    {
+        std::string in = moduleOf(input), out = moduleOf(output);
+        return isOutputPlug(output) && isInputPlug(input) && in != out
+            && parentOf(in) == parentOf(out) && !sources.count(input)
+            && !reaches(in, out);
+    }
+
+    bool apply(const Op &op)
+    {
+        switch (op.kind) {
+        case Op::NewModule:
+            if (types.count(op.a) || !isContainer(parentOf(op.a)))
+                return false;
+            types[op.a] = op.b;
+            return true;
+
+        case Op::DeleteModule:
+            if (!types.count(op.a))
+                return false;
+            remove(op.a);
+            return true;
+
+        case Op::Instantiate:
+            if (!types.count(op.b) || types.count(op.a) || !isContainer(parentOf(op.a))
+                    || isInside(parentOf(op.a), op.b))
+                return false;
+            copy(op.b, op.a);
+            return true;
+
+        case Op::Connect:
+            if (!canConnect(op.a, op.b))
+                return false;
+            sources[op.b] = op.a;
+            return true;
+
+        case Op::Disconnect:
+            if (!sources.count(op.b) || sources[op.b] != op.a)
+                return false;
+            sources.erase(op.b);
+            return true;
+
+        case Op::Set:
+            if (!types.count(moduleOf(op.a)))
+                return false;
+            values[op.a] = op.value;
+            return true;
+
+        case Op::Step:
+            return true;
+        }
+        return false;
+    }
+
+    // Plugs compared after each step
+    std::vector<std::string> checkedPlugs() const
+    {
+        std::vector<std::string> result;
+        for (auto &it: types)
+            if (it.second == "add" || it.second == "multiply" || it.second == "container")
+                for (auto &plug: outputPlugs(it.first))
+                    result.push_back(plug);
+        return result;
+    }
+
+    // False if the plug cannot be evaluated (unconnected input, missing value).
+    // peak is the largest absolute value met while evaluating it.
+    bool evaluate(const std::string &plug, double &result, double &peak)
+    {
+        std::set<std::string> visiting;
+        peak = 0;
+        return evaluate(plug, result, peak, visiting);
+    }
+
+private:
+    void remove(const std::string &path)
+    {
+        for (auto it = types.begin(); it != types.end();)
+            it = isInside(it->first, path) ? types.erase(it) : ++it;
+        for (auto it = values.begin(); it != values.end();)
+            it = isInside(moduleOf(it->first), path) ? values.erase(it) : ++it;
+        for (auto it = sources.begin(); it != sources.end();)
+            it = isInside(moduleOf(it->first), path) || isInside(moduleOf(it->second), path)
+                ? sources.erase(it) : ++it;
+    }
+
+    static std::string rename(const std::string &path, const std::string &from, const std::string &to)
+    {
+        return to + path.substr(from.size());
+    }
+
+    void copy(const std::string &from, const std::string &to)
+    {
+        std::map<std::string, std::string> newTypes, newSources;
+        std::map<std::string, double> newValues;
+        for (auto &it: types)
+            if (isInside(it.first, from))
+                newTypes[rename(it.first, from, to)] = it.second;
+        for (auto &it: values)
+            if (isInside(moduleOf(it.first), from))
+                newValues[rename(it.first, from, to)] = it.second;
+        for (auto &it: sources)
+            if (isBelow(moduleOf(it.first), from) && isBelow(moduleOf(it.second), from))
+                newSources[rename(it.first, from, to)] = rename(it.second, from, to);
+        types.insert(newTypes.begin(), newTypes.end());
+        values.insert(newValues.begin(), newValues.end());
+        sources.insert(newSources.begin(), newSources.end());
+    }
+
+    bool evaluateInput(const std::string &plug, double &result, double &peak,
+        std::set<std::string> &visiting)
+    {
+        auto it = sources.find(plug);
+        return it != sources.end() && evaluate(it->second, result, peak, visiting);
+    }
+
+    bool evaluate(const std::string &plug, double &result, double &peak,
+        std::set<std::string> &visiting)
+    {
+        if (!visiting.insert(plug).second)
+            return false;
+
+        std::string module = moduleOf(plug);
+        const std::string &type = types.at(module);
+        double op1, op2;
+        bool ok = false;
+
+        if (type == "add" || type == "multiply") {
+            ok = evaluateInput(module + "#op1", op1, peak, visiting)
+                && evaluateInput(module + "#op2", op2, peak, visiting);
+            if (ok)
+                result = type == "add" ? op1 + op2 : op1 * op2;
+        } else if (type == "input" && !parentOf(module).empty()) {
+            ok = evaluateInput(parentOf(module) + "#" + nameOf(module), result, peak, visiting);
+        } else if (type == "value" || type == "input") {
+            ok = values.count(plug);
+            if (ok)
+                result = values.at(plug);
+        } else if (type == "container") {
+            ok = evaluateInput(join(module, plug.substr(plug.find('#') + 1)) + "#value",
+                result, peak, visiting);
+        }
+
+        if (ok)
+            peak = std::max(peak, std::fabs(result));
+        visiting.erase(plug);
+        return ok;
+    }
+};
+
+static void applyToEngine(swsEngine &sws, const Op &op)
+{
+    switch (op.kind) {
+    case Op::NewModule:    sws.newModule(op.a, op.b); break;
+    case Op::DeleteModule: sws.deleteModule(op.a); break;
+    case Op::Instantiate:  sws.instantiateModule(op.a, op.b); break;
+    case Op::Connect:      sws.connect(op.a, op.b); break;
+    case Op::Disconnect:   sws.disconnect(op.a, op.b); break;
+    case Op::Set:          sws.set(op.a, op.value); break;
+    case Op::Step:         sws.step(); break;
+    }
+}
+
+static std::string toCode(const Op &op)
+{
+    switch (op.kind) {
+    case Op::NewModule:    return "sws.newModule(\"" + op.a + "\", \"" + op.b + "\");";
+    case Op::DeleteModule: return "sws.deleteModule(\"" + op.a + "\");";
+    case Op::Instantiate:  return "sws.instantiateModule(\"" + op.a + "\", \"" + op.b + "\");";
+    case Op::Connect:      return "sws.connect(\"" + op.a + "\", \"" + op.b + "\");";
+    case Op::Disconnect:   return "sws.disconnect(\"" + op.a + "\", \"" + op.b + "\");";
+    case Op::Set:          return "sws.set(\"" + op.a + "\", " + std::to_string(op.value) + ");";
+    case Op::Step:         return "sws.step();";
+    }
+    return "";
+}
+
+// Runs ops on a fresh engine and on the model. Invalid means the sequence
+// itself is not a valid schema edit (which happens while shrinking).
+static Outcome replay(const std::vector<Op> &ops, std::string &failure)
+{
+    Model model;
+    swsEngine sws;
+
+    for (const Op &op: ops) {
+        if (!model.apply(op))
+            return Invalid;
+
+        try {
+            applyToEngine(sws, op);
+
+            if (op.kind != Op::Step)
+                continue;
+
+            for (auto &plug: model.checkedPlugs()) {
+                double expected, peak;
+                if (!model.evaluate(plug, expected, peak))
+                    return Invalid;
+                if (peak > maxCompared)
+                    continue;
+                double got = sws.get(plug);
+                if (got != expected) {
+                    std::ostringstream stream;
+                    stream << "sws.get(\"" << plug << "\") expected " << expected << " got " << got;
+                    failure = stream.str();
+                    return Fail;
+                }
+            }
+        } catch (const std::exception &e) {
+            failure = toCode(op) + " threw " + typeid(e).name() + ": " + e.what();
+            return Fail;
+        } catch (...) {
+            failure = toCode(op) + " threw an unknown exception";
+            return Fail;
+        }
+    }
+    return Pass;
+}
+
+static bool mentions(const Op &op, const std::string &path)
+{
+    return (!op.a.empty() && isInside(moduleOf(op.a), path))
+        || (!op.b.empty() && op.kind != Op::NewModule && isInside(moduleOf(op.b), path));
+}
+
+// Keeps candidate in place of ops if it still fails
+static bool reduce(std::vector<Op> &ops, const std::vector<Op> &candidate, std::string &failure)
+{
+    std::string candidateFailure;
+    if (candidate.size() >= ops.size() || replay(candidate, candidateFailure) != Fail)
+        return false;
+    ops = candidate;
+    failure = candidateFailure;
+    return true;
+}
+
+// Removes whole modules (with every call mentioning them), then chunks of
+// calls of decreasing size, until nothing more can be removed
+static std::vector<Op> shrink(std::vector<Op> ops, std::string &failure)
+{
+    bool reduced = true;
+    while (reduced) {
+        reduced = false;
+
+        // Restarts from the first call after each removal
+        for (size_t i = 0; i < ops.size();) {
+            if (ops[i].kind == Op::NewModule || ops[i].kind == Op::Instantiate) {
+                std::string path = ops[i].a;
+                std::vector<Op> candidate;
+                for (const Op &op: ops)
+                    if (!mentions(op, path))
+                        candidate.push_back(op);
+                if (reduce(ops, candidate, failure)) {
+                    reduced = true;
+                    i = 0;
+                    continue;
+                }
+            }
+            i++;
+        }
+
+        for (size_t chunk = ops.size() / 2; chunk >= 1; chunk /= 2) {
+            for (size_t start = 0; start < ops.size();) {
+                std::vector<Op> candidate(ops.begin(), ops.begin() + start);
+                if (start + chunk < ops.size())
+                    candidate.insert(candidate.end(), ops.begin() + start + chunk, ops.end());
+                if (reduce(ops, candidate, failure))
+                    reduced = true;
+                else
+                    start += chunk;
+            }
+        }
+    }
+    return ops;
+}
+
+// Generates a random valid edit sequence, keeping a model up to date so
+// that every generated call is legal and every input stays connected.
+class Generator
+{
+public:
+    std::vector<Op> ops;
+
+    Generator(unsigned int seed): rng(seed) {}
+
+    void generate(int actions)
+    {
+        emit(Op{Op::NewModule, "in", "input", 0});
+        emit(Op{Op::Set, "in#value", "", value()});
+        for (int i = 0; i < 2; i++)
+            newValue("");
+
+        for (int i = 0; i < actions; i++) {
+            int action = random(100);
+            std::string container = pick(containers());
+            if (action < 25)
+                newArithmetic(container);
+            else if (action < 33)
+                newValue(container);
+            else if (action < 41)
+                newContainer(container);
+            else if (action < 47)
+                instantiate();
+            else if (action < 59)
+                rewire();
+            else if (action < 67)
+                deleteUnused();
+            else if (action < 87)
+                setValue();
+            else
+                emit(Op{Op::Step, "", "", 0});
+        }
+        emit(Op{Op::Step, "", "", 0});
+    }
+
+private:
+    static const int maxDepth = 3;
+
+    Model model;
+    std::mt19937 rng;
+    int nextId = 0;
+
+    int random(int n) { return rng() % n; }
+    int value() { return random(7) - 3; }
+
+    std::string pick(const std::vector<std::string> &list)
+    {
+        return list[random(list.size())];
+    }
+
+    void emit(const Op &op)
+    {
+        model.apply(op);
+        ops.push_back(op);
+    }
+
+    std::string newPath(const std::string &container)
+    {
+        return join(container, "m" + std::to_string(nextId++));
+    }
+
+    static int depth(const std::string &path)
+    {
+        return path.empty() ? 0 : 1 + std::count(path.begin(), path.end(), '/');
+    }
+
+    std::vector<std::string> containers()
+    {
+        std::vector<std::string> result = { "" };
+        for (auto &it: model.types)
+            if (it.second == "container")
+                result.push_back(it.first);
+        return result;
+    }
+
+    void connectRandom(const std::string &input)
+    {
+        std::vector<std::string> candidates;
+        for (auto &module: model.children(parentOf(moduleOf(input))))
+            for (auto &output: model.outputPlugs(module))
+                if (model.canConnect(output, input))
+                    candidates.push_back(output);
+        // Every schema holds an input module, so there is always a candidate
+        // for the inputs of a module that has no consumer yet
+        if (!candidates.empty())
+            emit(Op{Op::Connect, pick(candidates), input, 0});
+    }
+
+    void newArithmetic(const std::string &container)
+    {
+        std::string path = newPath(container);
+        emit(Op{Op::NewModule, path, random(3) ? "add" : "multiply", 0});
+        connectRandom(path + "#op1");
+        connectRandom(path + "#op2");
+    }
+
+    void newValue(const std::string &container)
+    {
+        std::string path = newPath(container);
+        emit(Op{Op::NewModule, path, "value", 0});
+        emit(Op{Op::Set, path + "#value", "", value()});
+    }
+
+    void newContainer(const std::string &container)
+    {
+        if (depth(container) >= maxDepth)
+            return;
+
+        std::string path = newPath(container);
+        emit(Op{Op::NewModule, path, "container", 0});
+        int inputs = 1 + random(2);
+        for (int i = 0; i < inputs; i++)
+            emit(Op{Op::NewModule, join(path, "i" + std::to_string(i)), "input", 0});
+        emit(Op{Op::NewModule, join(path, "o0"), "output", 0});
+        int modules = 1 + random(3);
+        for (int i = 0; i < modules; i++)
+            newArithmetic(path);
+        connectRandom(join(path, "o0") + "#value");
+
+        for (auto &input: model.inputPlugs(path))
+            connectRandom(input);
+    }
+
+    void instantiate()
+    {
+        std::vector<std::string> sources = containers();
+        sources.erase(sources.begin());
+        if (sources.empty())
+            return;
+        std::string source = pick(sources);
+
+        std::vector<std::string> targets;
+        for (auto &container: containers())
+            if (!isInside(container, source))
+                targets.push_back(container);
+
+        std::string path = newPath(pick(targets));
+        emit(Op{Op::Instantiate, path, source, 0});
+        for (auto &input: model.inputPlugs(path))
+            connectRandom(input);
+    }
+
+    void rewire()
+    {
+        if (model.sources.empty())
+            return;
+        auto it = model.sources.begin();
+        std::advance(it, random(model.sources.size()));
+        std::string input = it->first;
+        emit(Op{Op::Disconnect, it->second, input, 0});
+        connectRandom(input);
+    }
+
+    void deleteUnused()
+    {
+        std::vector<std::string> candidates;
+        for (auto &it: model.types)
+            if (it.second != "input" && it.second != "output" && !model.hasConsumers(it.first))
+                candidates.push_back(it.first);
+        if (!candidates.empty())
+            emit(Op{Op::DeleteModule, pick(candidates), "", 0});
+    }
+
+    void setValue()
+    {
+        std::vector<std::string> candidates;
+        for (auto &it: model.types)
+            if (it.second == "value" || (it.second == "input" && parentOf(it.first).empty()))
+                candidates.push_back(it.first + "#value");
+        emit(Op{Op::Set, pick(candidates), "", value()});
+    }
+};
+
+static bool checkRandomSchema(unsigned int seed)
+{
+    Generator generator(seed);
+    generator.generate(60);
+
+    std::string failure;
+    Outcome outcome = replay(generator.ops, failure);
+    if (outcome == Pass)
+        return true;
+    if (outcome == Invalid) {
+        testout() << "\tSeed " << seed << ": generated an invalid sequence" << endl;
+        return false;
+    }
+
+    std::vector<Op> ops = shrink(generator.ops, failure);
+    testout() << "\tSeed " << seed << ", reduced from " << generator.ops.size()
+              << " to " << ops.size() << " calls:" << endl;
+    for (const Op &op: ops)
+        testout() << "\t\t" << toCode(op) << endl;
+    testout() << "\t" << failure << endl;
+    return false;
+}
+
+void testRandomSchemas()
+{
+    const unsigned int seeds = 50;
+
+    TEST("Random schemas",
+        for (unsigned int seed = 1; seed <= seeds; seed++) {
+            TESTTRUE("Seed " + std::to_string(seed),
+                return checkRandomSchema(seed);
+            );
+        }
+    );
+}
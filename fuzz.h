@@ -0,0 +1,27 @@
+/*
+Test Lib SWS - Unit tests for libsws
+Copyright (C) 2022 Pierre-Yves Rollo <dev@pyrollo.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FUZZ_H
+#define FUZZ_H
+
+// Builds random schemas, edits them and compares every step() of swsEngine
+// with a reference evaluator. Failing cases are shrunk and printed as a
+// sequence of swsEngine calls.
+void testRandomSchemas();
+
+#endif // FUZZ_H
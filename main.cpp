@@ -16,9 +16,13 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <cstdlib>
 #include <iostream>
+#include <sstream>
+#include <thread>
 #include "swsengine.h"
 #include "test.h"
+#include "fuzz.h"
 
 void testModuleHierarchy()
 {
@@ -214,12 +218,12 @@ bool compareUnorderedSet(std::unordered_set<T> expected, std::unordered_set<T> g
   if (expected == got)
       return true;
 
-  printf("\tExpected:\n\t\t");
-  for (auto it: expected) { printf("%s, ", it.c_str()); }
-  printf("\n");
-  printf("\tGot:\n\t\t");
-  for (auto it: got) { printf("%s, ", it.c_str()); }
-  printf("\n");
+  testout() << "\tExpected:\n\t\t";
+  for (auto it: expected) { testout() << it << ", "; }
+  testout() << "\n";
+  testout() << "\tGot:\n\t\t";
+  for (auto it: got) { testout() << it << ", "; }
+  testout() << "\n";
 
   return false;
 }
@@ -357,55 +361,59 @@ void testBasicSchemaStep()
 }
 
 
+void buildNestedSchema(swsEngine &sws)
+{
+    // Custom1: 3 input add
+    sws.newModule("custom1", "container");
+
+    sws.newModule("custom1/add1", "add");
+    sws.newModule("custom1/add2", "add");
+
+    sws.newModule("custom1/op1", "input");
+    sws.newModule("custom1/op2", "input");
+    sws.newModule("custom1/op3", "input");
+    sws.newModule("custom1/result", "output");
+
+    sws.connect("custom1/op1#value", "custom1/add1#op1");
+    sws.connect("custom1/op2#value", "custom1/add1#op2");
+    sws.connect("custom1/op3#value", "custom1/add2#op1");
+    sws.connect("custom1/add1#result", "custom1/add2#op2");
+    sws.connect("custom1/add2#result", "custom1/result#value");
+
+    // Custom2: Doubler
+    sws.newModule("custom2", "container");
+
+    sws.newModule("custom2/mult", "multiply");
+    sws.newModule("custom2/value", "value");
+    sws.set("custom2/value#value", 2);
+
+    sws.newModule("custom2/op", "input");
+    sws.newModule("custom2/result", "output");
+
+    sws.connect("custom2/mult#op1",  "custom2/op#value");
+    sws.connect("custom2/mult#op2",  "custom2/value#value");
+    sws.connect("custom2/mult#result",  "custom2/result#value");
+
+    // Main schema
+    sws.newModule("in1", "input");
+    sws.newModule("in2", "input");
+    sws.newModule("in3", "input");
+    sws.newModule("out", "output");
+
+    sws.connect("in1#value", "custom1#op1");
+    sws.connect("in2#value", "custom1#op2");
+    sws.connect("in3#value", "custom1#op3");
+    sws.connect("custom1#result", "custom2#op");
+    sws.connect("custom2#result", "out#value");
+}
+
 void testNestedSchemaStep()
 {
     TEST("Nested schema step",
         swsEngine sws;
 
         TESTNOEXCEPTION("Create fixtures",
-
-            // Custom1: 3 input add
-            sws.newModule("custom1", "container");
-
-            sws.newModule("custom1/add1", "add");
-            sws.newModule("custom1/add2", "add");
-
-            sws.newModule("custom1/op1", "input");
-            sws.newModule("custom1/op2", "input");
-            sws.newModule("custom1/op3", "input");
-            sws.newModule("custom1/result", "output");
-
-            sws.connect("custom1/op1#value", "custom1/add1#op1");
-            sws.connect("custom1/op2#value", "custom1/add1#op2");
-            sws.connect("custom1/op3#value", "custom1/add2#op1");
-            sws.connect("custom1/add1#result", "custom1/add2#op2");
-            sws.connect("custom1/add2#result", "custom1/result#value");
-
-            // Custom2: Doubler
-            sws.newModule("custom2", "container");
-
-            sws.newModule("custom2/mult", "multiply");
-            sws.newModule("custom2/value", "value");
-            sws.set("custom2/value#value", 2);
-
-            sws.newModule("custom2/op", "input");
-            sws.newModule("custom2/result", "output");
-
-            sws.connect("custom2/mult#op1",  "custom2/op#value");
-            sws.connect("custom2/mult#op2",  "custom2/value#value");
-            sws.connect("custom2/mult#result",  "custom2/result#value");
-
-            // Main schema
-            sws.newModule("in1", "input");
-            sws.newModule("in2", "input");
-            sws.newModule("in3", "input");
-            sws.newModule("out", "output");
-
-            sws.connect("in1#value", "custom1#op1");
-            sws.connect("in2#value", "custom1#op2");
-            sws.connect("in3#value", "custom1#op3");
-            sws.connect("custom1#result", "custom2#op");
-            sws.connect("custom2#result", "out#value");
+            buildNestedSchema(sws);
         );
 
         TESTEQUAL("Step 1", 12,
@@ -481,16 +489,1288 @@ void testInstanciateModule()
     );
 }
 
-int main()
+void testScheduleUpdate()
+{
+    // Every graph edit between two steps must be taken into account by the
+    // next step, whatever the engine caches about evaluation order.
+    TEST("Schedule update",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("val1", "value");
+            sws.newModule("val2", "value");
+            sws.newModule("add1", "add");
+            sws.connect("val1#value", "add1#op1");
+            sws.connect("val2#value", "add1#op2");
+            sws.set("val1#value", 1);
+            sws.set("val2#value", 2);
+        );
+
+        TESTEQUAL("Step before edits", 3,
+            sws.step();
+            return sws.get("add1#result");
+        );
+
+        TESTEQUAL("Step after newModule and connect", 6,
+            sws.newModule("mult1", "multiply");
+            sws.connect("add1#result", "mult1#op1");
+            sws.connect("val2#value", "mult1#op2");
+            sws.step();
+            return sws.get("mult1#result");
+        );
+
+        TESTEQUAL("Step after disconnect and reconnect", 3,
+            sws.newModule("val3", "value");
+            sws.set("val3#value", 1);
+            sws.disconnect("val2#value", "mult1#op2");
+            sws.connect("val3#value", "mult1#op2");
+            sws.step();
+            return sws.get("mult1#result");
+        );
+
+        TESTEQUAL("Step after inserting a module in a chain", 4,
+            sws.newModule("add2", "add");
+            sws.disconnect("add1#result", "mult1#op1");
+            sws.connect("add1#result", "add2#op1");
+            sws.connect("val3#value", "add2#op2");
+            sws.connect("add2#result", "mult1#op1");
+            sws.step();
+            return sws.get("mult1#result");
+        );
+
+        TESTEQUAL("Step after deleteModule", 10,
+            sws.deleteModule("val3");
+            sws.connect("val2#value", "add2#op2");
+            sws.connect("val2#value", "mult1#op2");
+            sws.step();
+            return sws.get("mult1#result");
+        );
+
+        TESTEQUAL("Step after instantiateModule", 20,
+            sws.instantiateModule("add3", "add1");
+            sws.connect("mult1#result", "add3#op1");
+            sws.connect("mult1#result", "add3#op2");
+            sws.step();
+            return sws.get("add3#result");
+        );
+    );
+}
+
+void testDeepNestedSchemaStep()
+{
+    // Pass-through containers nested several levels deep around a single add:
+    //
+    // in -> c#in -> c/c#in -> ... -> add#op1
+    //                                   add#result -> ... -> c/c#out -> c#out -> out
+    //                        value -> add#op2
+    const int depth = 6;
+
+    TEST("Deep nested schema step",
+        swsEngine sws;
+        std::string path;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("in", "input");
+            sws.newModule("out", "output");
+
+            for (int level = 0; level < depth; level++) {
+                std::string parent = path;
+                path += (level ? "/c" : "c");
+                sws.newModule(path, "container");
+                sws.newModule(path + "/in", "input");
+                sws.newModule(path + "/out", "output");
+                if (level) {
+                    sws.connect(parent + "/in#value", path + "#in");
+                    sws.connect(path + "#out", parent + "/out#value");
+                }
+            }
+
+            sws.newModule(path + "/add", "add");
+            sws.newModule(path + "/value", "value");
+            sws.set(path + "/value#value", 1);
+            sws.connect(path + "/in#value", path + "/add#op1");
+            sws.connect(path + "/value#value", path + "/add#op2");
+            sws.connect(path + "/add#result", path + "/out#value");
+
+            sws.connect("in#value", "c#in");
+            sws.connect("c#out", "out#value");
+        );
+
+        TESTEQUAL("Step 1", 5,
+            sws.set("in#value", 4);
+            sws.step();
+            return sws.get("out#value");
+        );
+
+        TESTEQUAL("Step 2", 8,
+            sws.set("in#value", 7);
+            sws.step();
+            return sws.get("out#value");
+        );
+
+        TESTEQUAL("Intermediate container plug stays readable", 8,
+            return sws.get("c/c/c#out");
+        );
+
+        TESTEQUAL("Innermost input plug stays readable", 7,
+            return sws.get(path + "/in#value");
+        );
+    );
+}
+
+void testPartialChangeStep()
+{
+    // +------+     +------+     +-------+     +------+
+    // | val1 |-----> add1 |-----> mult1 |-----> add3 |
+    // | val2 |----->      |  +-->       |  +-->      |
+    // +------+     +------+  |  +-------+  |  +------+
+    //                  val3 -+       val4 -+
+    //
+    //                  val5 -+-> add2 (op1, op2)
+    TEST("Partial change step",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("val1", "value");
+            sws.newModule("val2", "value");
+            sws.newModule("val3", "value");
+            sws.newModule("val4", "value");
+            sws.newModule("val5", "value");
+            sws.newModule("add1", "add");
+            sws.newModule("add2", "add");
+            sws.newModule("add3", "add");
+            sws.newModule("mult1", "multiply");
+            sws.connect("val1#value", "add1#op1");
+            sws.connect("val2#value", "add1#op2");
+            sws.connect("add1#result", "mult1#op1");
+            sws.connect("val3#value", "mult1#op2");
+            sws.connect("mult1#result", "add3#op1");
+            sws.connect("val4#value", "add3#op2");
+            sws.connect("val5#value", "add2#op1");
+            sws.connect("val5#value", "add2#op2");
+        );
+
+        TESTEQUAL("Step 1", 16,
+            sws.set("val1#value", 1);
+            sws.set("val2#value", 2);
+            sws.set("val3#value", 2);
+            sws.set("val4#value", 10);
+            sws.set("val5#value", 3);
+            sws.step();
+            return sws.get("add3#result");
+        );
+
+        TESTEQUAL("Step without change", 16,
+            sws.step();
+            sws.step();
+            return sws.get("add3#result");
+        );
+
+        TESTEQUAL("Change in independent branch - changed branch", 8,
+            sws.set("val5#value", 4);
+            sws.step();
+            return sws.get("add2#result");
+        );
+
+        TESTEQUAL("Change in independent branch - other branch", 16,
+            return sws.get("add3#result");
+        );
+
+        TESTEQUAL("Set same value", 16,
+            sws.set("val4#value", 10);
+            sws.step();
+            return sws.get("add3#result");
+        );
+
+        TESTEQUAL("Change absorbed downstream (multiply by zero)", 10,
+            sws.set("val3#value", 0);
+            sws.step();
+            sws.set("val1#value", 5);
+            sws.step();
+            return sws.get("add3#result");
+        );
+
+        TESTEQUAL("Upstream of absorbed change is up to date", 7,
+            return sws.get("add1#result");
+        );
+
+        TESTEQUAL("Change after absorbed change", 8,
+            sws.set("val3#value", 1);
+            sws.set("val4#value", 1);
+            sws.step();
+            return sws.get("add3#result");
+        );
+    );
+}
+
+void testPlugAccess()
+{
+    TEST("Plug access",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("val", "value");
+            sws.newModule("container", "container");
+            sws.newModule("container/container", "container");
+            sws.newModule("container/container/val", "value");
+            sws.newModule("container/container/other", "value");
+        );
+
+        TESTEQUAL("Set and get at root level", 3,
+            sws.set("val#value", 3);
+            return sws.get("val#value");
+        );
+
+        TESTEQUAL("Set and get in nested container", 4,
+            sws.set("container/container/val#value", 4);
+            return sws.get("container/container/val#value");
+        );
+
+        TESTEQUAL("Repeated set and get", 99,
+            int last = 0;
+            for (int i = 0; i < 100; i++) {
+                sws.set("container/container/val#value", i);
+                last = sws.get("container/container/val#value");
+            }
+            return last;
+        );
+
+        TESTEQUAL("Sibling still accessible after deletion", 5,
+            sws.set("container/container/other#value", 5);
+            sws.deleteModule("container/container/val");
+            return sws.get("container/container/other#value");
+        );
+
+        TESTEXCEPTION("Cannot get plug of deleted module",
+            sws::unknown_module,
+            sws.get("container/container/val#value");
+        );
+
+        TESTEXCEPTION("Cannot set plug of deleted module",
+            sws::unknown_module,
+            sws.set("container/container/val#value", 1);
+        );
+
+        TESTNOEXCEPTION("Delete container",
+            sws.deleteModule("container/container");
+        );
+
+        TESTEXCEPTION("Cannot get plug in deleted container",
+            sws::unknown_module,
+            sws.get("container/container/other#value");
+        );
+
+        TESTEQUAL("Recreated module is accessible", 6,
+            sws.newModule("container/container", "container");
+            sws.newModule("container/container/other", "value");
+            sws.set("container/container/other#value", 6);
+            return sws.get("container/container/other#value");
+        );
+    );
+}
+
+void testInputTrace()
+{
+    // out = (in1 + in2) * in1, driven by one sample per step
+    const int samples = 8;
+    const int in1[samples] = { 0, 1, 2, 3, 3, 3, -1, 2 };
+    const int in2[samples] = { 0, 0, 1, 1, 2, -3, 4, 5 };
+
+    TEST("Input trace",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("in1", "input");
+            sws.newModule("in2", "input");
+            sws.newModule("out", "output");
+            sws.newModule("add", "add");
+            sws.newModule("mult", "multiply");
+            sws.connect("in1#value", "add#op1");
+            sws.connect("in2#value", "add#op2");
+            sws.connect("add#result", "mult#op1");
+            sws.connect("in1#value", "mult#op2");
+            sws.connect("mult#result", "out#value");
+        );
+
+        TESTTRUE("Replay trace",
+            bool ok = true;
+            for (int i = 0; i < samples; i++) {
+                sws.set("in1#value", in1[i]);
+                sws.set("in2#value", in2[i]);
+                sws.step();
+                int expected = (in1[i] + in2[i]) * in1[i];
+                int got = sws.get("out#value");
+                if (got != expected) {
+                    testout() << "\tSample " << i << ": expected " << expected << " got " << got << "\n";
+                    ok = false;
+                }
+            }
+            return ok;
+        );
+
+        TESTEQUAL("Last sample is kept after trace", 14,
+            sws.step();
+            return sws.get("out#value");
+        );
+    );
+}
+
+void testWideSchemaStep()
+{
+    // Many independent branches sharing one factor, summed by a chain of adds:
+    //
+    // valN -> multN (x factor) -> sumN = sum(N-1) + multN
+    const int width = 32;
+
+    TEST("Wide schema step",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("factor", "value");
+            sws.newModule("zero", "value");
+            sws.set("zero#value", 0);
+            for (int i = 0; i < width; i++) {
+                std::string n = std::to_string(i);
+                sws.newModule("val" + n, "value");
+                sws.newModule("mult" + n, "multiply");
+                sws.newModule("sum" + n, "add");
+                sws.connect("val" + n + "#value", "mult" + n + "#op1");
+                sws.connect("factor#value", "mult" + n + "#op2");
+                sws.connect("mult" + n + "#result", "sum" + n + "#op2");
+                sws.connect(i ? "sum" + std::to_string(i - 1) + "#result" : "zero#value",
+                    "sum" + n + "#op1");
+            }
+        );
+
+        TESTTRUE("Step 1 - every branch",
+            sws.set("factor#value", 3);
+            for (int i = 0; i < width; i++)
+                sws.set("val" + std::to_string(i) + "#value", i);
+            sws.step();
+            for (int i = 0; i < width; i++)
+                if (sws.get("mult" + std::to_string(i) + "#result") != 3 * i)
+                    return false;
+            return true;
+        );
+
+        TESTEQUAL("Step 1 - sum", 3 * width * (width - 1) / 2,
+            return sws.get("sum" + std::to_string(width - 1) + "#result");
+        );
+
+        TESTEQUAL("Step 2 - shared input changed", -width * (width - 1) / 2,
+            sws.set("factor#value", -1);
+            sws.step();
+            return sws.get("sum" + std::to_string(width - 1) + "#result");
+        );
+    );
+}
+
+void testManyInstancesStep()
+{
+    // One "entity" container instantiated many times, each instance stepped
+    // with its own input and gain in the same step.
+    const int count = 16;
+
+    TEST("Many instances step",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("entity",        "container");
+            sws.newModule("entity/op",     "input");
+            sws.newModule("entity/result", "output");
+            sws.newModule("entity/gain",   "value");
+            sws.newModule("entity/mult",   "multiply");
+            sws.set("entity/gain#value", 2);
+            sws.connect("entity/op#value",     "entity/mult#op1");
+            sws.connect("entity/gain#value",   "entity/mult#op2");
+            sws.connect("entity/mult#result",  "entity/result#value");
+
+            for (int i = 0; i < count; i++)
+                sws.instantiateModule("entity" + std::to_string(i), "entity");
+        );
+
+        TESTTRUE("Instances share initial gain",
+            for (int i = 0; i < count; i++)
+                sws.set("entity" + std::to_string(i) + "#op", i);
+            sws.step();
+            for (int i = 0; i < count; i++)
+                if (sws.get("entity" + std::to_string(i) + "#result") != 2 * i)
+                    return false;
+            return true;
+        );
+
+        TESTTRUE("Instances keep their own gain",
+            for (int i = 0; i < count; i++)
+                sws.set("entity" + std::to_string(i) + "/gain#value", i % 3);
+            sws.step();
+            for (int i = 0; i < count; i++)
+                if (sws.get("entity" + std::to_string(i) + "#result") != i * (i % 3))
+                    return false;
+            return true;
+        );
+
+        TESTEQUAL("Template is not affected by instances", 2,
+            return sws.get("entity/gain#value");
+        );
+    );
+}
+
+void testInstanceIndependence()
+{
+    typedef std::unordered_set<std::string> PathList;
+
+    TEST("Instance independence",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("complex1",        "container");
+            sws.newModule("complex1/op",     "input");
+            sws.newModule("complex1/result", "output");
+            sws.newModule("complex1/value",  "value");
+            sws.newModule("complex1/add",    "add");
+
+            sws.set("complex1/value#value", 1);
+
+            sws.connect("complex1/op#value",     "complex1/add#op1");
+            sws.connect("complex1/value#value",  "complex1/add#op2");
+            sws.connect("complex1/result#value", "complex1/add#result");
+
+            sws.instantiateModule("complex2", "complex1");
+            sws.instantiateModule("complex2/complex3", "complex1");
+        );
+
+        TESTNOEXCEPTION("Add module to instance",
+            sws.newModule("complex2/extra", "add");
+        );
+
+        TESTEXCEPTION("Module added to instance is not in source",
+            sws::unknown_module,
+            sws.getModuleType("complex1/extra");
+        );
+
+        TESTTRUE("Plug added to source is not in instance",
+            sws.newModule("complex1/result2", "output");
+            PathList got = sws.listPlugs("complex2");
+            PathList expected;
+            expected.insert("complex2#op");
+            expected.insert("complex2#result");
+            return compareUnorderedSet(expected, got);
+        );
+
+        TESTEQUAL("Rewired instance - instance", 10,
+            sws.disconnect("complex2/value#value", "complex2/add#op2");
+            sws.connect("complex2/op#value", "complex2/add#op2");
+            sws.set("complex1#op", 5);
+            sws.set("complex2#op", 5);
+            sws.step();
+            return sws.get("complex2#result");
+        );
+
+        TESTEQUAL("Rewired instance - source", 6,
+            return sws.get("complex1#result");
+        );
+
+        TESTEQUAL("Value set in source is not in nested instance", 4,
+            sws.set("complex1/value#value", 3);
+            sws.set("complex2/complex3#op", 3);
+            sws.step();
+            return sws.get("complex2/complex3#result");
+        );
+
+        TESTEQUAL("Instance outlives its source", 14,
+            sws.deleteModule("complex1");
+            sws.set("complex2#op", 7);
+            sws.step();
+            return sws.get("complex2#result");
+        );
+    );
+}
+
+void testModuleChurn()
+{
+    const int rounds = 50;
+
+    TEST("Module churn",
+        swsEngine sws;
+
+        TESTEQUAL("Repeatedly create, step and delete a container subtree", 4 * rounds,
+            int total = 0;
+            sws.newModule("in", "input");
+            for (int i = 0; i < rounds; i++) {
+                sws.newModule("tree", "container");
+                sws.newModule("tree/op", "input");
+                sws.newModule("tree/result", "output");
+                sws.newModule("tree/sub", "container");
+                sws.newModule("tree/sub/op", "input");
+                sws.newModule("tree/sub/result", "output");
+                sws.newModule("tree/sub/add", "add");
+                sws.connect("tree/sub/op#value", "tree/sub/add#op1");
+                sws.connect("tree/sub/op#value", "tree/sub/add#op2");
+                sws.connect("tree/sub/add#result", "tree/sub/result#value");
+                sws.connect("tree/op#value", "tree/sub#op");
+                sws.connect("tree/sub#result", "tree/result#value");
+                sws.connect("in#value", "tree#op");
+                sws.set("in#value", 2);
+                sws.step();
+                total += sws.get("tree#result");
+                sws.deleteModule("tree");
+            }
+            return total;
+        );
+
+        TESTEXCEPTION("Deleted subtree is gone",
+            sws::unknown_module,
+            sws.getModuleType("tree/sub/add");
+        );
+
+        TESTEQUAL("Name can be reused with another type", "add",
+            sws.newModule("tree", "add");
+            return sws.getModuleType("tree");
+        );
+
+        TESTNOEXCEPTION("Destroy engine holding a large hierarchy",
+            swsEngine big;
+            std::string path;
+            for (int level = 0; level < 8; level++) {
+                path += (level ? "/c" : "c");
+                big.newModule(path, "container");
+                for (int i = 0; i < 32; i++)
+                    big.newModule(path + "/add" + std::to_string(i), "add");
+            }
+        );
+    );
+}
+
+void testChainConnecting()
+{
+    // add0 -> add1 -> ... -> add19 through op1 of each module, plus an
+    // unconnected "free" add module.
+    typedef std::unordered_set<std::string> PathList;
+    const int length = 20;
+
+    TEST("Chain connecting",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("free", "add");
+            for (int i = 0; i < length; i++) {
+                sws.newModule("add" + std::to_string(i), "add");
+                if (i)
+                    sws.connect("add" + std::to_string(i - 1) + "#result",
+                        "add" + std::to_string(i) + "#op1");
+            }
+        );
+
+        TESTEXCEPTION("Cannot close the chain",
+            sws::illegal_connection,
+            sws.connect("add19#result", "add0#op2");
+        );
+
+        TESTEXCEPTION("Cannot connect downstream to middle of the chain",
+            sws::illegal_connection,
+            sws.connect("add19#result", "add10#op2");
+        );
+
+        TESTTRUE("Nothing but free is connectable to chain head",
+            PathList got = sws.listConnectable("add0#op2");
+            PathList expected;
+            expected.insert("free#result");
+            return compareUnorderedSet(expected, got);
+        );
+
+        TESTTRUE("Only upstream and free are connectable to chain middle",
+            PathList got = sws.listConnectable("add10#op2");
+            PathList expected;
+            expected.insert("free#result");
+            for (int i = 0; i < 10; i++)
+                expected.insert("add" + std::to_string(i) + "#result");
+            return compareUnorderedSet(expected, got);
+        );
+
+        TESTNOEXCEPTION("Can connect upstream to middle of the chain",
+            sws.connect("add5#result", "add10#op2");
+        );
+
+        TESTNOEXCEPTION("Cut the chain",
+            sws.disconnect("add9#result", "add10#op1");
+        );
+
+        TESTEXCEPTION("Shortcut still forbids loops",
+            sws::illegal_connection,
+            sws.connect("add15#result", "add3#op2");
+        );
+
+        TESTNOEXCEPTION("Cut chain allows connecting back",
+            sws.disconnect("add5#result", "add10#op2");
+            sws.connect("add15#result", "add3#op2");
+        );
+
+        TESTTRUE("Connectable outputs follow the cut",
+            PathList got = sws.listConnectable("add4#op2");
+            PathList expected;
+            expected.insert("free#result");
+            for (int i = 0; i < 4; i++)
+                expected.insert("add" + std::to_string(i) + "#result");
+            for (int i = 10; i < length; i++)
+                expected.insert("add" + std::to_string(i) + "#result");
+            return compareUnorderedSet(expected, got);
+        );
+    );
+}
+
+void testNestedSchemaReference()
+{
+    // Expected state of the schema built by buildNestedSchema(), as seen
+    // through the public API. An engine restored from a saved image must
+    // match it too.
+    typedef std::unordered_set<std::string> PathList;
+
+    TEST("Nested schema reference",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            buildNestedSchema(sws);
+        );
+
+        TESTTRUE("Plugs of custom1",
+            PathList got = sws.listPlugs("custom1");
+            PathList expected;
+            expected.insert("custom1#op1");
+            expected.insert("custom1#op2");
+            expected.insert("custom1#op3");
+            expected.insert("custom1#result");
+            return compareUnorderedSet(expected, got);
+        );
+
+        TESTTRUE("Plugs of custom2",
+            PathList got = sws.listPlugs("custom2");
+            PathList expected;
+            expected.insert("custom2#op");
+            expected.insert("custom2#result");
+            return compareUnorderedSet(expected, got);
+        );
+
+        TESTTRUE("Plugs of root modules",
+            const char *modules[] = { "in1", "in2", "in3", "out" };
+            for (auto module: modules) {
+                PathList expected;
+                expected.insert(std::string(module) + "#value");
+                if (!compareUnorderedSet(expected, sws.listPlugs(module)))
+                    return false;
+            }
+            return true;
+        );
+
+        TESTTRUE("Module types",
+            const char *modules[][2] = {
+                { "custom1", "container" }, { "custom1/add1", "add" }, { "custom1/add2", "add" },
+                { "custom1/op1", "input" }, { "custom1/result", "output" },
+                { "custom2", "container" }, { "custom2/mult", "multiply" }, { "custom2/value", "value" },
+                { "custom2/op", "input" }, { "custom2/result", "output" },
+                { "in1", "input" }, { "out", "output" } };
+            for (auto module: modules)
+                if (sws.getModuleType(module[0]) != module[1]) {
+                    testout() << "\t" << module[0] << ": got " << sws.getModuleType(module[0]) << "\n";
+                    return false;
+                }
+            return true;
+        );
+
+        TESTEQUAL("Plug type custom1#op1", "input", return sws.getPlugType("custom1#op1"););
+        TESTEQUAL("Plug type custom2#result", "output", return sws.getPlugType("custom2#result"););
+        TESTEQUAL("Value set in custom2", 2, return sws.get("custom2/value#value"););
+
+        TESTTRUE("Values after step",
+            sws.set("in1#value", 3);
+            sws.set("in2#value", -1);
+            sws.set("in3#value", 4);
+            sws.step();
+            return sws.get("custom1/add1#result") == 2
+                && sws.get("custom1#result") == 6
+                && sws.get("custom2/mult#result") == 12
+                && sws.get("out#value") == 12;
+        );
+    );
+}
+
+void testConstantSubgraph()
+{
+    // const1, const2 -> add -> mult <- const3 : depends only on value modules
+    TEST("Constant subgraph",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("const1", "value");
+            sws.newModule("const2", "value");
+            sws.newModule("const3", "value");
+            sws.newModule("add", "add");
+            sws.newModule("mult", "multiply");
+            sws.set("const1#value", 1);
+            sws.set("const2#value", 2);
+            sws.set("const3#value", 3);
+            sws.connect("const1#value", "add#op1");
+            sws.connect("const2#value", "add#op2");
+            sws.connect("add#result", "mult#op1");
+            sws.connect("const3#value", "mult#op2");
+        );
+
+        TESTEQUAL("Step 1", 9,
+            sws.step();
+            return sws.get("mult#result");
+        );
+
+        TESTEQUAL("Step again", 9,
+            sws.step();
+            sws.step();
+            return sws.get("mult#result");
+        );
+
+        TESTEQUAL("Constant changed", 15,
+            sws.set("const3#value", 5);
+            sws.step();
+            return sws.get("mult#result");
+        );
+
+        TESTEQUAL("Constant replaced by an input", 20,
+            sws.newModule("in", "input");
+            sws.disconnect("const1#value", "add#op1");
+            sws.connect("in#value", "add#op1");
+            sws.set("in#value", 2);
+            sws.step();
+            return sws.get("mult#result");
+        );
+
+        TESTEQUAL("Input change after replacement", 35,
+            sws.set("in#value", 5);
+            sws.step();
+            return sws.get("mult#result");
+        );
+    );
+}
+
+void testNestedConstant()
+{
+    TEST("Constant in nested container",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            buildNestedSchema(sws);
+            sws.set("in1#value", 1);
+            sws.set("in2#value", 2);
+            sws.set("in3#value", 3);
+        );
+
+        TESTEQUAL("Step 1", 12,
+            sws.step();
+            return sws.get("out#value");
+        );
+
+        TESTEQUAL("Constant changed in container", 18,
+            sws.set("custom2/value#value", 3);
+            sws.step();
+            return sws.get("out#value");
+        );
+    );
+}
+
+void testArithmeticChain()
+{
+    // in -> add1 (+in) -> mult1 (x3) -> add2 (+add1) -> mult2 (x mult1) -> out
+    TEST("Arithmetic chain",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("in", "input");
+            sws.newModule("three", "value");
+            sws.newModule("add1", "add");
+            sws.newModule("mult1", "multiply");
+            sws.newModule("add2", "add");
+            sws.newModule("mult2", "multiply");
+            sws.newModule("out", "output");
+            sws.set("three#value", 3);
+            sws.connect("in#value", "add1#op1");
+            sws.connect("in#value", "add1#op2");
+            sws.connect("add1#result", "mult1#op1");
+            sws.connect("three#value", "mult1#op2");
+            sws.connect("mult1#result", "add2#op1");
+            sws.connect("add1#result", "add2#op2");
+            sws.connect("add2#result", "mult2#op1");
+            sws.connect("mult1#result", "mult2#op2");
+            sws.connect("mult2#result", "out#value");
+            sws.set("in#value", 1);
+            sws.step();
+        );
+
+        TESTEQUAL("Output", 48, return sws.get("out#value"););
+        TESTEQUAL("Intermediate add1", 2, return sws.get("add1#result"););
+        TESTEQUAL("Intermediate mult1", 6, return sws.get("mult1#result"););
+        TESTEQUAL("Intermediate add2", 8, return sws.get("add2#result"););
+        TESTEQUAL("Intermediate mult2", 48, return sws.get("mult2#result"););
+
+        TESTEQUAL("Intermediate after new step", -16,
+            sws.set("in#value", -2);
+            sws.step();
+            return sws.get("add2#result");
+        );
+
+        TESTEQUAL("Output after new step", 192, return sws.get("out#value"););
+
+        TESTEQUAL("Intermediate in nested container", 3,
+            swsEngine nested;
+            buildNestedSchema(nested);
+            nested.set("in1#value", 1);
+            nested.set("in2#value", 2);
+            nested.set("in3#value", 3);
+            nested.step();
+            return nested.get("custom1/add1#result");
+        );
+    );
+}
+
+void testStepBoundary()
+{
+    // Computed plugs (module results) read between two steps hold the values
+    // of the last step, whatever set() calls were made since. A plug that was
+    // set reads back the value set right away.
+    TEST("Step boundary",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("val1", "value");
+            sws.newModule("val2", "value");
+            sws.newModule("add1", "add");
+            sws.newModule("add2", "add");
+            sws.connect("val1#value",  "add1#op1");
+            sws.connect("val2#value",  "add1#op2");
+            sws.connect("add1#result", "add2#op1");
+            sws.connect("val2#value",  "add2#op2");
+            sws.set("val1#value", 1);
+            sws.set("val2#value", 2);
+            sws.step();
+        );
+
+        TESTEQUAL("Step 1", 5, return sws.get("add2#result"););
+
+        TESTEQUAL("Output unchanged by set before step", 5,
+            sws.set("val1#value", 10);
+            sws.set("val2#value", 20);
+            return sws.get("add2#result");
+        );
+
+        TESTEQUAL("Intermediate unchanged by set before step", 3,
+            return sws.get("add1#result");
+        );
+
+        TESTEQUAL("Set plug reads back before step", 20,
+            return sws.get("val2#value");
+        );
+
+        TESTEQUAL("Last set before step wins", 44,
+            sws.set("val1#value", 4);
+            sws.step();
+            return sws.get("add2#result");
+        );
+
+        TESTTRUE("Outputs are consistent after step",
+            return sws.get("add2#result") == sws.get("add1#result") + 20;
+        );
+    );
+}
+
+void testFailedEdits()
+{
+    // A rejected edit must leave the schema exactly as it was.
+    typedef std::unordered_set<std::string> PathList;
+
+    TEST("Failed edits",
+        swsEngine sws;
+        PathList connectable;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("val1", "value");
+            sws.newModule("val2", "value");
+            sws.newModule("add1", "add");
+            sws.newModule("add2", "add");
+            sws.newModule("complex1", "container");
+            sws.newModule("complex1/op", "input");
+            sws.connect("val1#value", "add1#op1");
+            sws.connect("val2#value", "add1#op2");
+            sws.connect("add1#result", "add2#op1");
+            sws.connect("val1#value", "add2#op2");
+
+            // add0 -> add3 <- add2, add0#op2 left free to try a loop on
+            sws.newModule("add0", "add");
+            sws.newModule("add3", "add");
+            sws.connect("val1#value", "add0#op1");
+            sws.connect("add0#result", "add3#op1");
+            sws.connect("add2#result", "add3#op2");
+
+            sws.set("val1#value", 1);
+            sws.set("val2#value", 2);
+            sws.step();
+            connectable = sws.listConnectable("complex1#op");
+        );
+
+        TESTEXCEPTION("Duplicate module is rejected",
+            sws::duplicate_name,
+            sws.newModule("add1", "multiply");
+        );
+
+        TESTEQUAL("Module type is unchanged", "add",
+            return sws.getModuleType("add1");
+        );
+
+        TESTEXCEPTION("Loop is rejected",
+            sws::illegal_connection,
+            sws.connect("add3#result", "add0#op2");
+        );
+
+        TESTEXCEPTION("Second connection to an input is rejected",
+            sws::already_connected,
+            sws.connect("val2#value", "add2#op2");
+        );
+
+        TESTEXCEPTION("Instance in itself is rejected",
+            sws::illegal_operation,
+            sws.instantiateModule("complex1/complex2", "complex1");
+        );
+
+        TESTEXCEPTION("No partial instance is left",
+            sws::unknown_module,
+            sws.getModuleType("complex1/complex2");
+        );
+
+        TESTTRUE("Connectable plugs are unchanged",
+            return compareUnorderedSet(connectable, sws.listConnectable("complex1#op"));
+        );
+
+        TESTEQUAL("Step result is unchanged", 4,
+            sws.step();
+            return sws.get("add2#result");
+        );
+    );
+}
+
+void testNameLookup()
+{
+    // Names sharing prefixes, and a name reused after deletion
+    typedef std::unordered_set<std::string> PathList;
+
+    TEST("Name lookup",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("add", "add");
+            sws.newModule("add1", "add");
+            sws.newModule("add10", "multiply");
+            sws.newModule("add1c", "container");
+            sws.newModule("add1c/add1", "value");
+        );
+
+        TESTTRUE("Types of modules sharing a prefix",
+            return sws.getModuleType("add") == "add"
+                && sws.getModuleType("add1") == "add"
+                && sws.getModuleType("add10") == "multiply"
+                && sws.getModuleType("add1c") == "container"
+                && sws.getModuleType("add1c/add1") == "value";
+        );
+
+        TESTTRUE("Plugs of nested module have full paths",
+            PathList got = sws.listPlugs("add1c/add1");
+            PathList expected;
+            expected.insert("add1c/add1#value");
+            return compareUnorderedSet(expected, got);
+        );
+
+        TESTNOEXCEPTION("Delete module sharing a prefix",
+            sws.deleteModule("add1");
+        );
+
+        TESTEXCEPTION("Deleted name is unknown",
+            sws::unknown_module,
+            sws.getModuleType("add1");
+        );
+
+        TESTEQUAL("Module sharing prefix survives deletion", "multiply",
+            return sws.getModuleType("add10");
+        );
+
+        TESTEQUAL("Nested module with deleted name survives deletion", "value",
+            return sws.getModuleType("add1c/add1");
+        );
+
+        TESTTRUE("Reused name has new plugs",
+            sws.newModule("add1", "value");
+            PathList got = sws.listPlugs("add1");
+            PathList expected;
+            expected.insert("add1#value");
+            return compareUnorderedSet(expected, got);
+        );
+
+        TESTTRUE("Connectable plugs use reused name",
+            PathList got = sws.listConnectable("add10#op1");
+            PathList expected;
+            expected.insert("add#result");
+            expected.insert("add1#value");
+            return compareUnorderedSet(expected, got);
+        );
+    );
+}
+
+void testConcurrentEngines()
+{
+    // What-if runs: in each engine, scenarios are instances of one base
+    // container, each with its own inputs and its own gain edit. Engines run
+    // on separate threads.
+    //
+    // base: (a + b) x gain, gain = 2
+    const int engines = 4;
+    const int scenarios = 8;
+
+    TEST("Concurrent engines",
+        TESTTRUE("Scenarios derived from one base, stepped in parallel",
+            // Failures are collected per engine, exceptions cannot cross threads
+            std::vector<std::string> errors(engines);
+            std::vector<std::thread> threads;
+            for (int engine = 0; engine < engines; engine++)
+                threads.push_back(std::thread([&errors, engine]() {
+                    std::ostringstream error;
+                    try {
+                        swsEngine sws;
+                        sws.newModule("base",        "container");
+                        sws.newModule("base/a",      "input");
+                        sws.newModule("base/b",      "input");
+                        sws.newModule("base/result", "output");
+                        sws.newModule("base/gain",   "value");
+                        sws.newModule("base/add",    "add");
+                        sws.newModule("base/mult",   "multiply");
+                        sws.set("base/gain#value", 2);
+                        sws.connect("base/a#value",     "base/add#op1");
+                        sws.connect("base/b#value",     "base/add#op2");
+                        sws.connect("base/add#result",  "base/mult#op1");
+                        sws.connect("base/gain#value",  "base/mult#op2");
+                        sws.connect("base/mult#result", "base/result#value");
+
+                        for (int scenario = 0; scenario < scenarios; scenario++) {
+                            std::string path = "whatif" + std::to_string(scenario);
+                            sws.instantiateModule(path, "base");
+                            sws.set(path + "/gain#value", scenario + 1);
+                            sws.set(path + "#a", engine);
+                            sws.set(path + "#b", scenario);
+                        }
+                        sws.set("base#a", 1);
+                        sws.set("base#b", 1);
+                        sws.step();
+
+                        for (int scenario = 0; scenario < scenarios; scenario++) {
+                            std::string path = "whatif" + std::to_string(scenario);
+                            int expected = (engine + scenario) * (scenario + 1);
+                            if (sws.get(path + "#result") != expected)
+                                error << path << ": expected " << expected
+                                      << " got " << sws.get(path + "#result") << " ";
+                        }
+                        // Edits on instances must not reach the base
+                        if (sws.get("base#result") != 4)
+                            error << "base: expected 4 got " << sws.get("base#result");
+                    } catch (const std::exception &e) {
+                        error << e.what();
+                    }
+                    errors[engine] = error.str();
+                }));
+            for (auto &thread: threads)
+                thread.join();
+
+            for (int engine = 0; engine < engines; engine++)
+                if (!errors[engine].empty()) {
+                    testout() << "\tEngine " << engine << ": " << errors[engine] << "\n";
+                    return false;
+                }
+            return true;
+        );
+    );
+}
+
+void testValueRange()
+{
+    // Values exactly representable by any engine value type, whether
+    // 32 bit integer or single precision float
+    TEST("Value range",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("val1", "value");
+            sws.newModule("val2", "value");
+            sws.newModule("add", "add");
+            sws.newModule("mult", "multiply");
+            sws.connect("val1#value", "add#op1");
+            sws.connect("val2#value", "add#op2");
+            sws.connect("val1#value", "mult#op1");
+            sws.connect("val2#value", "mult#op2");
+        );
+
+        TESTEQUAL("Zero", 0,
+            sws.set("val1#value", 0);
+            return sws.get("val1#value");
+        );
+
+        TESTEQUAL("Negative value", -7,
+            sws.set("val1#value", -7);
+            return sws.get("val1#value");
+        );
+
+        TESTEQUAL("Large value", 16777216,
+            sws.set("val1#value", 16777216);
+            return sws.get("val1#value");
+        );
+
+        TESTEQUAL("Add with opposite signs", -4,
+            sws.set("val1#value", 3);
+            sws.set("val2#value", -7);
+            sws.step();
+            return sws.get("add#result");
+        );
+
+        TESTEQUAL("Multiply with opposite signs", -21,
+            return sws.get("mult#result");
+        );
+
+        TESTEQUAL("Multiply negative values", 21,
+            sws.set("val1#value", -3);
+            sws.step();
+            return sws.get("mult#result");
+        );
+
+        TESTEQUAL("Multiply by zero", 0,
+            sws.set("val2#value", 0);
+            sws.step();
+            return sws.get("mult#result");
+        );
+
+        TESTEQUAL("Large result", 4194304,
+            sws.set("val1#value", 2048);
+            sws.set("val2#value", 2048);
+            sws.step();
+            return sws.get("mult#result");
+        );
+    );
+}
+
+void testModuleTypes()
+{
+    // Plugs declared by each built-in module type
+    typedef std::unordered_set<std::string> PathList;
+
+    TEST("Module types",
+        swsEngine sws;
+
+        TESTNOEXCEPTION("Create fixtures",
+            sws.newModule("add", "add");
+            sws.newModule("multiply", "multiply");
+            sws.newModule("value", "value");
+            sws.newModule("input", "input");
+            sws.newModule("output", "output");
+            sws.newModule("container", "container");
+            sws.newModule("container/in", "input");
+            sws.newModule("container/out", "output");
+        );
+
+        TESTEXCEPTION("Unknown module type is rejected",
+            sws::unknown_schema,
+            sws.newModule("unknown", "nosuchtype");
+        );
+
+        TESTTRUE("Add plugs",
+            PathList got = sws.listPlugs("add");
+            PathList expected;
+            expected.insert("add#op1");
+            expected.insert("add#op2");
+            expected.insert("add#result");
+            return compareUnorderedSet(expected, got);
+        );
+
+        TESTTRUE("Multiply plugs",
+            PathList got = sws.listPlugs("multiply");
+            PathList expected;
+            expected.insert("multiply#op1");
+            expected.insert("multiply#op2");
+            expected.insert("multiply#result");
+            return compareUnorderedSet(expected, got);
+        );
+
+        TESTTRUE("Value plugs",
+            PathList got = sws.listPlugs("value");
+            PathList expected;
+            expected.insert("value#value");
+            return compareUnorderedSet(expected, got);
+        );
+
+        TESTTRUE("Input plugs",
+            PathList got = sws.listPlugs("input");
+            PathList expected;
+            expected.insert("input#value");
+            return compareUnorderedSet(expected, got);
+        );
+
+        TESTTRUE("Output plugs",
+            PathList got = sws.listPlugs("output");
+            PathList expected;
+            expected.insert("output#value");
+            return compareUnorderedSet(expected, got);
+        );
+
+        TESTTRUE("Container plugs come from its input and output modules",
+            PathList got = sws.listPlugs("container");
+            PathList expected;
+            expected.insert("container#in");
+            expected.insert("container#out");
+            return compareUnorderedSet(expected, got);
+        );
+
+        TESTEQUAL("Add operand is an input", "input", return sws.getPlugType("add#op1"););
+        TESTEQUAL("Add result is an output", "output", return sws.getPlugType("add#result"););
+        TESTEQUAL("Multiply operand is an input", "input", return sws.getPlugType("multiply#op2"););
+        TESTEQUAL("Multiply result is an output", "output", return sws.getPlugType("multiply#result"););
+        TESTEQUAL("Value is an output", "output", return sws.getPlugType("value#value"););
+        TESTEQUAL("Input module value is an output", "output", return sws.getPlugType("input#value"););
+        TESTEQUAL("Output module value is an input", "input", return sws.getPlugType("output#value"););
+        TESTEQUAL("Container input plug is an input", "input", return sws.getPlugType("container#in"););
+        TESTEQUAL("Container output plug is an output", "output", return sws.getPlugType("container#out"););
+    );
+}
+
+int main(int argc, char *argv[])
 {
-    testModuleHierarchy();
-    testModuleDeletion();
-    testConnecting();
-    testIntrospection();
-    testListConnectable();
-    testBasicSchemaStep();
-    testNestedSchemaStep();
-    testInstanciateModule();
-
-    return 0;
+    std::vector<TestGroup> groups = {
+        TESTGROUP(testModuleHierarchy),
+        TESTGROUP(testModuleDeletion),
+        TESTGROUP(testModuleChurn),
+        TESTGROUP(testConnecting),
+        TESTGROUP(testIntrospection),
+        TESTGROUP(testModuleTypes),
+        TESTGROUP(testPlugAccess),
+        TESTGROUP(testNameLookup),
+        TESTGROUP(testListConnectable),
+        TESTGROUP(testChainConnecting),
+        TESTGROUP(testFailedEdits),
+        TESTGROUP(testBasicSchemaStep),
+        TESTGROUP(testPartialChangeStep),
+        TESTGROUP(testArithmeticChain),
+        TESTGROUP(testValueRange),
+        TESTGROUP(testStepBoundary),
+        TESTGROUP(testInputTrace),
+        TESTGROUP(testWideSchemaStep),
+        TESTGROUP(testNestedSchemaStep),
+        TESTGROUP(testDeepNestedSchemaStep),
+        TESTGROUP(testNestedSchemaReference),
+        TESTGROUP(testConcurrentEngines),
+        TESTGROUP(testConstantSubgraph),
+        TESTGROUP(testNestedConstant),
+        TESTGROUP(testInstanciateModule),
+        TESTGROUP(testManyInstancesStep),
+        TESTGROUP(testInstanceIndependence),
+        TESTGROUP(testScheduleUpdate),
+        TESTGROUP(testRandomSchemas)
+    };
+
+    return runtests(groups, argc, argv) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -16,16 +16,268 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include "test.h"
 
 using namespace std;
 
+typedef std::chrono::steady_clock Clock;
+
+static double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct CaseReport
+{
+    std::string title;
+    bool passed;
+    double ms;
+};
+
+struct TestReport
+{
+    std::string title;
+    double ms;
+    std::vector<CaseReport> cases;
+};
+
+struct GroupReport
+{
+    const TestGroup *group;
+    std::ostringstream output;
+    std::vector<TestReport> tests;
+    double ms = 0;
+    bool done = false;
+};
+
+// Group being run by the current thread, null when running outside runtests()
+static thread_local GroupReport *currentGroup = nullptr;
+static thread_local Clock::time_point testStart;
+static thread_local Clock::time_point caseStart;
+
+std::ostream &testout()
+{
+    return currentGroup ? currentGroup->output : cout;
+}
+
+void begintest(std::string title)
+{
+    testout() << "Test: " << title << endl;
+    testStart = Clock::now();
+    if (currentGroup)
+        currentGroup->tests.push_back(TestReport{title, 0, {}});
+}
+
+void endtest(unsigned int total, unsigned int passed)
+{
+    double ms = elapsedMs(testStart);
+    if (currentGroup && !currentGroup->tests.empty())
+        currentGroup->tests.back().ms = ms;
+
+    if (passed == total)
+        testout() << "[\033[32mSUCCESS\033[0m] All " << total << " test passed in " << ms << " ms." << endl;
+    else
+        testout() << "[\033[31mFAILED \033[0m] Failed " << total - passed << " of " << total << " tests in " << ms << " ms." << endl;
+    testout() << endl;
+}
+
+void startcase()
+{
+    caseStart = Clock::now();
+}
+
+static void endcase(const std::string &title, bool passed)
+{
+    if (currentGroup && !currentGroup->tests.empty())
+        currentGroup->tests.back().cases.push_back(CaseReport{title, passed, elapsedMs(caseStart)});
+}
+
 void failtest(std::string title)
 {
-    cout << "[\033[31mFAILED \033[0m] \033[93m" << title << "\033[0m" << endl;
+    endcase(title, false);
+    testout() << "[\033[31mFAILED \033[0m] \033[93m" << title << "\033[0m" << endl;
 }
 
 void passtest(std::string title)
 {
-    cout << "[\033[32mSUCCESS\033[0m] \033[93m" << title << "\033[0m" << endl;
+    endcase(title, true);
+    testout() << "[\033[32mSUCCESS\033[0m] \033[93m" << title << "\033[0m" << endl;
+}
+
+// FNV-1a, so that shards stay the same across platforms and when groups are
+// added or reordered
+static unsigned int hashName(const char *name)
+{
+    unsigned int hash = 2166136261u;
+    for (; *name; name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static std::string jsonString(const std::string &text)
+{
+    std::ostringstream stream;
+    stream << '"';
+    for (unsigned char c: text) {
+        if (c == '"' || c == '\\')
+            stream << '\\' << c;
+        else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            stream << escaped;
+        } else
+            stream << c;
+    }
+    stream << '"';
+    return stream.str();
+}
+
+static void writeJson(std::ostream &out, const std::vector<GroupReport *> &reports, double ms)
+{
+    out << "{\n  \"ms\": " << ms << ",\n  \"groups\": [";
+    for (size_t g = 0; g < reports.size(); g++) {
+        GroupReport *report = reports[g];
+        out << (g ? "," : "") << "\n    {\"name\": " << jsonString(report->group->name)
+            << ", \"ms\": " << report->ms << ", \"tests\": [";
+        for (size_t t = 0; t < report->tests.size(); t++) {
+            const TestReport &test = report->tests[t];
+            out << (t ? "," : "") << "\n      {\"title\": " << jsonString(test.title)
+                << ", \"ms\": " << test.ms << ", \"cases\": [";
+            for (size_t c = 0; c < test.cases.size(); c++) {
+                const CaseReport &testCase = test.cases[c];
+                out << (c ? "," : "") << "\n        {\"title\": " << jsonString(testCase.title)
+                    << ", \"passed\": " << (testCase.passed ? "true" : "false")
+                    << ", \"ms\": " << testCase.ms << "}";
+            }
+            out << "]}";
+        }
+        out << "]}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int runtests(const std::vector<TestGroup> &groups, int argc, char *argv[])
+{
+    unsigned int jobs = std::thread::hardware_concurrency();
+    std::string filter;
+    unsigned int shard = 0, shards = 1;
+    std::string json;
+    bool list = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--jobs" && hasValue)
+            jobs = atoi(argv[++i]);
+        else if (arg == "--filter" && hasValue)
+            filter = argv[++i];
+        else if (arg == "--shard" && hasValue
+                && sscanf(argv[++i], "%u/%u", &shard, &shards) == 2 && shard < shards)
+            continue;
+        else if (arg == "--json" && hasValue)
+            json = argv[++i];
+        else if (arg == "--list")
+            list = true;
+        else {
+            cerr << "Usage: " << argv[0]
+                 << " [--jobs N] [--filter TEXT] [--shard I/N] [--json FILE] [--list]" << endl;
+            return -1;
+        }
+    }
+    if (jobs < 1)
+        jobs = 1;
+
+    std::vector<GroupReport *> reports;
+    for (const TestGroup &group: groups) {
+        if (std::string(group.name).find(filter) == std::string::npos)
+            continue;
+        if (hashName(group.name) % shards != shard)
+            continue;
+        reports.push_back(new GroupReport);
+        reports.back()->group = &group;
+    }
+
+    if (list) {
+        for (GroupReport *report: reports) {
+            cout << report->group->name << endl;
+            delete report;
+        }
+        return 0;
+    }
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::atomic<size_t> next(0);
+    Clock::time_point start = Clock::now();
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < reports.size(); i = next++) {
+            GroupReport *report = reports[i];
+            Clock::time_point groupStart = Clock::now();
+            currentGroup = report;
+            report->group->run();
+            currentGroup = nullptr;
+            report->ms = elapsedMs(groupStart);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            report->done = true;
+            finished.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < jobs && i < reports.size(); i++)
+        workers.push_back(std::thread(worker));
+
+    // Print each group as soon as it and all groups before it are done
+    unsigned int total = 0, failed = 0;
+    for (GroupReport *report: reports) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [report]() { return report->done; });
+        }
+        cout << report->output.str();
+        for (const TestReport &test: report->tests)
+            for (const CaseReport &testCase: test.cases) {
+                total++;
+                if (!testCase.passed)
+                    failed++;
+            }
+    }
+
+    for (std::thread &thread: workers)
+        thread.join();
+
+    double ms = elapsedMs(start);
+    cout << "Ran " << reports.size() << " groups, " << total << " tests, "
+         << failed << " failed in " << ms << " ms." << endl;
+
+    // A report that cannot be written fails the run, CI relies on it
+    bool reported = true;
+    if (!json.empty()) {
+        std::ofstream out(json);
+        if (out)
+            writeJson(out, reports, ms);
+        out.close();
+        if (!out) {
+            cerr << "Could not write JSON report to " << json << endl;
+            reported = false;
+        }
+    }
+
+    for (GroupReport *report: reports)
+        delete report;
+
+    return reported ? failed : -1;
 }
@@ -19,28 +19,31 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #ifndef TEST_H
 #define TEST_H
 
+#include <ostream>
 #include <string>
 #include <sstream>
+#include <vector>
 
 using namespace std;
 
 #define CATCHEXCEPTIONS(TITLE)                                                 \
     catch (const std::exception & e) {                                         \
-        cout << "Failed: Unexpected exception" << endl;                        \
-        cout << "Message: " << e.what() << endl;                               \
-        cout << "TypeId: " << typeid(e).name() << endl;                        \
+        testout() << "Failed: Unexpected exception" << endl;                   \
+        testout() << "Message: " << e.what() << endl;                          \
+        testout() << "TypeId: " << typeid(e).name() << endl;                   \
         failtest(TITLE);                                                       \
     } catch (...) {                                                            \
         std::exception_ptr p = std::current_exception();                       \
-        cout << "Failed: Unexpected exception" << endl;                        \
+        testout() << "Failed: Unexpected exception" << endl;                   \
         if (p)                                                                 \
-            cout << "Type: " << p.__cxa_exception_type()->name() << std::endl; \
+            testout() << "Type: " << p.__cxa_exception_type()->name() << endl; \
         failtest(TITLE);                                                       \
     }
 
 #define TESTNOEXCEPTION(TITLE, ...)                                            \
     try {                                                                      \
         TEST_TOTAL++;                                                          \
+        startcase();                                                           \
         __VA_ARGS__;                                                           \
         TEST_PASSED++;                                                         \
         passtest(TITLE);                                                       \
@@ -50,6 +53,7 @@ using namespace std;
 #define TESTEXCEPTION(TITLE, EXCEPTION, ...)                                   \
     try {                                                                      \
         TEST_TOTAL++;                                                          \
+        startcase();                                                           \
         __VA_ARGS__;                                                           \
         failtest(TITLE);                                                       \
     } catch (EXCEPTION) {                                                      \
@@ -61,6 +65,7 @@ using namespace std;
 #define TESTTRUE(TITLE, ...)                                                   \
     try {                                                                      \
         TEST_TOTAL++;                                                          \
+        startcase();                                                           \
         auto fct = [&]() {                                                     \
             __VA_ARGS__;                                                       \
         };                                                                     \
@@ -76,6 +81,7 @@ using namespace std;
 #define TESTEQUAL(TITLE, VALUE, ...)                                           \
     try {                                                                      \
         TEST_TOTAL++;                                                          \
+        startcase();                                                           \
         auto fct = [&]() {                                                     \
             __VA_ARGS__;                                                       \
         };                                                                     \
@@ -95,17 +101,37 @@ using namespace std;
 
 #define TEST(TITLE, ...) \
     { \
-        cout << "Test: " << TITLE << endl; \
+        begintest(TITLE); \
         unsigned int TEST_TOTAL = 0; \
         unsigned int TEST_PASSED = 0; \
         __VA_ARGS__; \
-        if (TEST_PASSED == TEST_TOTAL) \
-            cout << "[\033[32mSUCCESS\033[0m] All " << TEST_TOTAL << " test passed." << endl; \
-        else \
-            cout << "[\033[31mFAILED \033[0m] Failed " << TEST_TOTAL - TEST_PASSED << " of " << TEST_TOTAL << " tests." << endl; \
-        cout << endl; \
+        endtest(TEST_TOTAL, TEST_PASSED); \
     }
 
+// A function holding one or more TEST blocks, run by runtests()
+struct TestGroup
+{
+    const char *name;
+    void (*run)();
+};
+
+#define TESTGROUP(FUNCTION) TestGroup{#FUNCTION, FUNCTION}
+
+// Runs test groups and returns the number of failed tests. Options:
+//   --jobs N       run N groups in parallel (default: number of cores)
+//   --filter TEXT  only run groups whose name contains TEXT
+//   --shard I/N    only run shard I (0 based) out of N, split by group name
+//   --json FILE    write a JSON report with per test durations to FILE
+//   --list         list selected groups without running them
+int runtests(const std::vector<TestGroup> &groups, int argc, char *argv[]);
+
+// Stream the running group writes to; output of parallel groups is kept
+// apart and printed in group order
+std::ostream &testout();
+
+void begintest(std::string title);
+void endtest(unsigned int total, unsigned int passed);
+void startcase();
 void failtest(std::string title);
 void passtest(std::string title);
 